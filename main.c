@@ -28,6 +28,14 @@
 #include <string.h>
 #include <stdarg.h>
 #include <math.h>
+#include <time.h>
+ 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define SVG_HAVE_X86_SIMD 1
+#  include <immintrin.h>
+#else
+#  define SVG_HAVE_X86_SIMD 0
+#endif
  
 void*
 xmalloc(size_t sz) {
@@ -61,6 +69,14 @@ xfprintf(FILE* f, const char* restrict fmt, ...) {
     va_end(args);
 }
  
+void
+xfwrite(const void* ptr, size_t sz, FILE* f) {
+    if (sz && fwrite(ptr, 1, sz, f) != sz) {
+        perror("fwrite");
+        exit(-1);
+    }
+}
+ 
 struct SVG_string {
     char* _bytes;
     size_t _size;
@@ -117,6 +133,76 @@ SVG_string_copy(struct SVG_string* new_str,
     memcpy(new_str->_bytes, old_str->_bytes, old_len);
 }
  
+void
+SVG_string_append(struct SVG_string* str, const char* bytes, size_t len) {
+    assert(str);
+    if (!len) return;
+    if (str->_length + len > str->_size) {
+        size_t new_size = str->_size * 2;
+        if (new_size < str->_length + len) new_size = str->_length + len;
+        char* new_bytes = xmalloc(new_size);
+        if (str->_length) memcpy(new_bytes, str->_bytes, str->_length);
+        free(str->_bytes);
+        str->_bytes = new_bytes;
+        str->_size = new_size;
+    }
+    memcpy(str->_bytes + str->_length, bytes, len);
+    str->_length += len;
+}
+ 
+/*
+ * Output target of the printers: everything written to a sink goes to its
+ * file, if any, is appended to its recording string, if any, and is passed on
+ * to the outer sink.
+ */
+struct SVG_sink {
+    FILE* _file;
+    struct SVG_string* _rec;
+    struct SVG_sink* _outer;
+};
+ 
+void
+SVG_sink_write(struct SVG_sink* sink, const char* bytes, size_t len) {
+    for (; sink; sink = sink->_outer) {
+        if (sink->_file) xfwrite(bytes, len, sink->_file);
+        if (sink->_rec) SVG_string_append(sink->_rec, bytes, len);
+    }
+}
+ 
+void
+SVG_sink_printf(struct SVG_sink* sink, const char* restrict fmt, ...) {
+    assert(sink);
+    va_list args;
+    va_start(args, fmt);
+    if (sink->_file && !sink->_rec && !sink->_outer) {
+        if (vfprintf(sink->_file, fmt, args) < 0) {
+            perror("vfprintf");
+            exit(-1);
+        }
+        va_end(args);
+        return;
+    }
+ 
+    va_list args_again;
+    va_copy(args_again, args);
+    char buf[256];
+    int len = vsnprintf(buf, sizeof buf, fmt, args);
+    if (len < 0) {
+        perror("vsnprintf");
+        exit(-1);
+    }
+    if ((size_t) len < sizeof buf) {
+        SVG_sink_write(sink, buf, (size_t) len);
+    } else {
+        char* big = xmalloc((size_t) len + 1);
+        vsnprintf(big, (size_t) len + 1, fmt, args_again);
+        SVG_sink_write(sink, big, (size_t) len);
+        free(big);
+    }
+    va_end(args_again);
+    va_end(args);
+}
+ 
 enum SVG_value_type {
     SVG_NULL,
     SVG_INT,
@@ -192,6 +278,46 @@ SVG_param_list_destroy(struct SVG_param_list* params) {
     free(it);
 }
  
+SVG_param
+SVG_param_list_find(struct SVG_param_list* pl, const char* const str) {
+    assert(pl);
+    assert(str);
+ 
+    size_t str_len = strlen(str);
+    for (SVG_param it = pl; it->_type != SVG_NULL; it = it->_next) {
+        if (it->_name->_length == str_len
+            && memcmp(it->_name->_bytes, str, str_len) == 0) return it;
+    }
+    return 0;
+}
+ 
+/*
+ * Overwrites the value of param in place. The type must stay the same, so
+ * numbers never reallocate and strings only do when they outgrow their buffer.
+ * Returns whether the value changed.
+ */
+int
+SVG_param_set(SVG_param param,
+              const enum SVG_value_type value_type,
+              void* const value,
+              size_t value_sz) {
+    assert(param);
+    assert(value);
+    assert(param->_type == value_type && "cannot change the type of a param in place");
+ 
+    if (param->_type == SVG_STRING) {
+        struct SVG_string* old_val = param->_value;
+        struct SVG_string* val = value;
+        if (old_val->_length == val->_length
+            && (!val->_length || memcmp(old_val->_bytes, val->_bytes, val->_length) == 0)) return 0;
+        SVG_string_copy(old_val, val);
+    } else {
+        if (memcmp(param->_value, value, value_sz) == 0) return 0;
+        memcpy(param->_value, value, value_sz);
+    }
+    return 1;
+}
+ 
 struct SVG_param_iteration {
     struct SVG_param_list* _it;
 };
@@ -238,7 +364,7 @@ SVG_param_it_deref(struct SVG_param_iteration* it) {
  
  
 void
-SVG_param_print(SVG_param param, FILE* outp) {
+SVG_param_print(SVG_param param, struct SVG_sink* outp) {
     assert(param);
     assert(outp);
  
@@ -247,30 +373,30 @@ SVG_param_print(SVG_param param, FILE* outp) {
             /*do nothing*/
             return;
         case SVG_INT:
-            xfprintf(outp, "%.*s=\"%d\"",
-                     SVG_FMT(*param->_name),
-                     *(int*) param->_value);
+            SVG_sink_printf(outp, "%.*s=\"%d\"",
+                            SVG_FMT(*param->_name),
+                            *(int*) param->_value);
             break;
         case SVG_FLOAT:
-            xfprintf(outp, "%.*s=\"%.1f\"",
-                     SVG_FMT(*param->_name),
-                     (double) *(float*) param->_value);
+            SVG_sink_printf(outp, "%.*s=\"%.1f\"",
+                            SVG_FMT(*param->_name),
+                            (double) *(float*) param->_value);
             break;
         case SVG_STRING:
-            xfprintf(outp, "%.*s=\"%.*s\"",
-                     SVG_FMT(*param->_name),
-                     SVG_FMT((*(struct SVG_string*) param->_value)));
+            SVG_sink_printf(outp, "%.*s=\"%.*s\"",
+                            SVG_FMT(*param->_name),
+                            SVG_FMT((*(struct SVG_string*) param->_value)));
             break;
         case SVG_COORD:
-            xfprintf(outp, "%.*s=\"%.4f\"",
-                     SVG_FMT(*param->_name),
-                     (double) *(float*) param->_value);
+            SVG_sink_printf(outp, "%.*s=\"%.4f\"",
+                            SVG_FMT(*param->_name),
+                            (double) *(float*) param->_value);
             break;
     }
 }
  
 void
-SVG_param_list_print(struct SVG_param_list* params, FILE* outp) {
+SVG_param_list_print(struct SVG_param_list* params, struct SVG_sink* outp) {
     for (struct SVG_param_iteration
                 it = SVG_param_it_begin(params),
                 end = SVG_param_it_end();
@@ -278,14 +404,14 @@ SVG_param_list_print(struct SVG_param_list* params, FILE* outp) {
          SVG_param_it_next(&it)) {
         SVG_param param = SVG_param_it_deref(&it);
         SVG_param_print(param, outp);
-        putc(' ', outp);
+        SVG_sink_write(outp, " ", 1);
     }
 }
  
 struct SVG_shape;
  
-typedef int (* SVG_proc_draw_start)(struct SVG_shape* this, FILE* outp);
-typedef int (* SVG_proc_draw_finish)(struct SVG_shape* this, FILE* outp);
+typedef int (* SVG_proc_draw_start)(struct SVG_shape* this, struct SVG_sink* outp);
+typedef int (* SVG_proc_draw_finish)(struct SVG_shape* this, struct SVG_sink* outp);
 typedef void (* SVG_proc_draw_destroy)(struct SVG_shape* this);
  
 struct SVG_shape {
@@ -297,6 +423,10 @@ struct SVG_shape {
     size_t _chld_sz;
     size_t _chld_len;
     void* _userdata;
+    struct SVG_shape* _parent;
+    int _dirty; // changed since last printed
+    int _cached; // _cache holds the current output of the whole subtree
+    struct SVG_string* _cache;
 };
  
 #define SVG_CAT(x, y) SVG_CAT_I(x, y)
@@ -305,9 +435,19 @@ struct SVG_shape {
 // member call for pseudo-oo
 #define MBR_CALL(obj, fn) (obj)->SVG_CAT(_, fn)
  
+void
+SVG_shape_touch(struct SVG_shape* this) {
+    assert(this);
+    for (struct SVG_shape* it = this; it; it = it->_parent) {
+        it->_dirty = 1;
+        it->_cached = 0;
+    }
+}
+ 
 struct SVG_shape*
 SVG_shape_add_child(struct SVG_shape* this, struct SVG_shape* chld) {
     assert(this);
+    assert(chld);
     if (this->_chld_sz == 0
         || this->_chld_len > this->_chld_sz - 1) {
         this->_chld_sz = (size_t) (ceill(this->_chld_sz * 1.5l) + 1);
@@ -319,18 +459,77 @@ SVG_shape_add_child(struct SVG_shape* this, struct SVG_shape* chld) {
         free(old_children);
     }
     this->_children[this->_chld_len++] = chld;
+    chld->_parent = this;
+    SVG_shape_touch(this);
     return this->_children[this->_chld_len - 1];
 }
  
+/*
+ * Sets the attribute called str in place, adding it if the shape does not
+ * have it yet. The shape is only marked dirty if the value actually changed.
+ */
+SVG_param
+SVG_shape_set_attr(struct SVG_shape* this,
+                   const char* const str,
+                   const enum SVG_value_type value_type,
+                   void* const value,
+                   size_t value_sz) {
+    assert(this);
+    assert(this->_params && "shape has no attributes");
+ 
+    SVG_param param = SVG_param_list_find(this->_params, str);
+    if (!param) {
+        param = SVG_param_list_add(this->_params, str, value_type, value, value_sz);
+        SVG_shape_touch(this);
+    } else if (SVG_param_set(param, value_type, value, value_sz)) {
+        SVG_shape_touch(this);
+    }
+    return param;
+}
+ 
+/*
+ * Subtrees left untouched since their last print record their output into
+ * their cache while being printed, and are written from the cache from then
+ * on; dirty ones are printed without recording.
+ */
 void
-SVG_print(struct SVG_shape* shp, FILE* outp) {
+SVG_print_impl(struct SVG_shape* shp, struct SVG_sink* outp) {
+    if (shp->_cached) {
+        SVG_sink_write(outp, shp->_cache->_bytes, shp->_cache->_length);
+        return;
+    }
+ 
+    struct SVG_sink rec = {
+           ._file = 0,
+           ._rec = 0,
+           ._outer = outp,
+    };
+    if (!shp->_dirty) {
+        if (!shp->_cache) shp->_cache = SVG_string_new(0);
+        shp->_cache->_length = 0;
+        rec._rec = shp->_cache;
+        outp = &rec;
+    }
+ 
     if (MBR_CALL(shp, start)(shp, outp)) exit(-1);
     if (shp->_chld_len) {
         for (size_t i = 0; i < shp->_chld_len; ++i) {
-            SVG_print(shp->_children[i], outp);
+            SVG_print_impl(shp->_children[i], outp);
         }
     }
     if (MBR_CALL(shp, finish)(shp, outp)) exit(-1);
+    shp->_cached = !shp->_dirty;
+    shp->_dirty = 0;
+}
+ 
+void
+SVG_print(struct SVG_shape* shp, FILE* outp) {
+    struct SVG_sink sink = {
+           ._file = outp,
+           ._rec = 0,
+           ._outer = 0,
+    };
+    SVG_print_impl(shp, &sink);
 }
  
 void
@@ -342,29 +541,30 @@ SVGSHP_universal_destroy(struct SVG_shape* this) {
     }
     free(this->_children);
     SVG_param_list_destroy(this->_params);
+    if (this->_cache) SVG_string_destroy(&this->_cache);
     free(this);
 }
  
 int
-SVGSHP_nl_finish(struct SVG_shape* this, FILE* outp) {
+SVGSHP_nl_finish(struct SVG_shape* this, struct SVG_sink* outp) {
     (void) this;
-    xfprintf(outp, "\n");
+    SVG_sink_printf(outp, "\n");
     return 0;
 }
  
 ///////////////////////////////////// ROOT /////////////////////////////////////
 int
-SVGSHP_root_start(struct SVG_shape* this, FILE* outp) {
-    xfprintf(outp, "<svg ");
+SVGSHP_root_start(struct SVG_shape* this, struct SVG_sink* outp) {
+    SVG_sink_printf(outp, "<svg ");
     SVG_param_list_print(this->_params, outp);
-    xfprintf(outp, ">\n");
+    SVG_sink_printf(outp, ">\n");
     return 0;
 }
  
 int
-SVGSHP_root_finish(struct SVG_shape* this, FILE* outp) {
+SVGSHP_root_finish(struct SVG_shape* this, struct SVG_sink* outp) {
     (void) this;
-    xfprintf(outp, "</svg>");
+    SVG_sink_printf(outp, "</svg>");
     return 0;
 }
  
@@ -384,6 +584,10 @@ SVGSHP_root_new(int width, int height) {
            ._chld_sz = 0,
            ._chld_len = 0,
            ._userdata = 0,
+           ._parent = 0,
+           ._dirty = 1,
+           ._cached = 0,
+           ._cache = 0,
     };
     SVG_param_list_add(shp->_params, "width", SVG_INT, &width, sizeof width);
     SVG_param_list_add(shp->_params, "height", SVG_INT, &height, sizeof height);
@@ -396,13 +600,13 @@ SVGSHP_root_new(int width, int height) {
  
 /////////////////////////////////// CONTENT ////////////////////////////////////
 int
-SVGSHP_content_start(struct SVG_shape* this, FILE* outp) {
-    xfprintf(outp, "%.*s\n", SVG_FMT(*(struct SVG_string*) this->_userdata));
+SVGSHP_content_start(struct SVG_shape* this, struct SVG_sink* outp) {
+    SVG_sink_printf(outp, "%.*s\n", SVG_FMT(*(struct SVG_string*) this->_userdata));
     return 0;
 }
  
 int
-SVGSHP_content_finish(struct SVG_shape* this, FILE* outp) {
+SVGSHP_content_finish(struct SVG_shape* this, struct SVG_sink* outp) {
     (void) this;
     (void) outp;
     return 0;
@@ -417,6 +621,7 @@ SVGSHP_content_destroy(struct SVG_shape* this) {
     }
     free(this->_children);
     SVG_string_destroy((struct SVG_string**) &this->_userdata);
+    if (this->_cache) SVG_string_destroy(&this->_cache);
     free(this);
 }
  
@@ -432,6 +637,10 @@ SVGSHP_content_new(const char* content) {
            ._chld_sz = 0,
            ._chld_len = 0,
            ._userdata = SVG_string_new(0),
+           ._parent = 0,
+           ._dirty = 1,
+           ._cached = 0,
+           ._cache = 0,
     };
  
     SVG_string_assign(shp->_userdata, content);
@@ -440,17 +649,17 @@ SVGSHP_content_new(const char* content) {
  
 ///////////////////////////////////// TEXT /////////////////////////////////////
 int
-SVGSHP_text_start(struct SVG_shape* this, FILE* outp) {
-    xfprintf(outp, "<text ");
+SVGSHP_text_start(struct SVG_shape* this, struct SVG_sink* outp) {
+    SVG_sink_printf(outp, "<text ");
     SVG_param_list_print(this->_params, outp);
-    xfprintf(outp, ">\n");
+    SVG_sink_printf(outp, ">\n");
     return 0;
 }
  
 int
-SVGSHP_text_finish(struct SVG_shape* this, FILE* outp) {
+SVGSHP_text_finish(struct SVG_shape* this, struct SVG_sink* outp) {
     (void) this;
-    xfprintf(outp, "</text>\n");
+    SVG_sink_printf(outp, "</text>\n");
     return 0;
 }
  
@@ -469,6 +678,10 @@ SVGSHP_text_new(int x, int y,
            ._chld_sz = 0,
            ._chld_len = 0,
            ._userdata = 0,
+           ._parent = 0,
+           ._dirty = 1,
+           ._cached = 0,
+           ._cache = 0,
     };
  
     SVG_shape_add_child(shp, SVGSHP_content_new(content));
@@ -487,10 +700,10 @@ SVGSHP_text_new(int x, int y,
  
 //////////////////////////////////// CIRCLE ////////////////////////////////////
 int
-SVGSHP_circle_start(struct SVG_shape* this, FILE* outp) {
-    xfprintf(outp, "<circle ");
+SVGSHP_circle_start(struct SVG_shape* this, struct SVG_sink* outp) {
+    SVG_sink_printf(outp, "<circle ");
     SVG_param_list_print(this->_params, outp);
-    xfprintf(outp, "/>");
+    SVG_sink_printf(outp, "/>");
     return 0;
 }
  
@@ -508,6 +721,10 @@ SVGSHP_circle_new(float r, int cx, int cy,
            ._chld_sz = 0,
            ._chld_len = 0,
            ._userdata = 0,
+           ._parent = 0,
+           ._dirty = 1,
+           ._cached = 0,
+           ._cache = 0,
     };
  
     SVG_param_list_add(shp->_params, "r", SVG_COORD, &r, sizeof r);
@@ -520,10 +737,10 @@ SVGSHP_circle_new(float r, int cx, int cy,
  
 ///////////////////////////////////// LINE /////////////////////////////////////
 int
-SVGSHP_line_start(struct SVG_shape* this, FILE* outp) {
-    xfprintf(outp, "<line ");
+SVGSHP_line_start(struct SVG_shape* this, struct SVG_sink* outp) {
+    SVG_sink_printf(outp, "<line ");
     SVG_param_list_print(this->_params, outp);
-    xfprintf(outp, "/>");
+    SVG_sink_printf(outp, "/>");
     return 0;
 }
  
@@ -541,6 +758,10 @@ SVGSHP_line_new(float x1, float y1,
            ._chld_sz = 0,
            ._chld_len = 0,
            ._userdata = 0,
+           ._parent = 0,
+           ._dirty = 1,
+           ._cached = 0,
+           ._cache = 0,
     };
  
     SVG_param_list_add(shp->_params, "x1", SVG_COORD, &x1, sizeof x1);
@@ -551,6 +772,182 @@ SVGSHP_line_new(float x1, float y1,
     return shp;
 }
  
+void
+SVGSHP_line_set(struct SVG_shape* this,
+                float x1, float y1,
+                float x2, float y2) {
+    SVG_shape_set_attr(this, "x1", SVG_COORD, &x1, sizeof x1);
+    SVG_shape_set_attr(this, "y1", SVG_COORD, &y1, sizeof y1);
+    SVG_shape_set_attr(this, "x2", SVG_COORD, &x2, sizeof x2);
+    SVG_shape_set_attr(this, "y2", SVG_COORD, &y2, sizeof y2);
+}
+ 
+//////////////////////////////////// SINCOS ////////////////////////////////////
+typedef void (* SVG_proc_sincos)(const float* x, float* s, float* c, size_t n);
+ 
+void
+SVG_sincos_scalar(const float* x, float* s, float* c, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        s[i] = sinf(x[i]);
+        c[i] = cosf(x[i]);
+    }
+}
+ 
+#if SVG_HAVE_X86_SIMD
+// Cody-Waite split of pi/2 and the cephes single precision polynomials on [-pi/4, pi/4]
+#define SVG_2OPI_F 0.636619772f
+#define SVG_PIO2_1F 1.5703125f
+#define SVG_PIO2_2F 4.837512969970703125e-4f
+#define SVG_PIO2_3F 7.54978995489188216e-8f
+ 
+#define SVG_SIN_C0F -1.9515295891e-4f
+#define SVG_SIN_C1F  8.3321608736e-3f
+#define SVG_SIN_C2F -1.6666654611e-1f
+ 
+#define SVG_COS_C0F  2.443315711809948e-5f
+#define SVG_COS_C1F -1.388731625493765e-3f
+#define SVG_COS_C2F  4.166664568298827e-2f
+ 
+/*
+ * The vector kernels work in single precision and are within a couple of ulps
+ * of sinf/cosf, not bit-identical to them; see clock_batch_check for how
+ * that shows in the printed coordinates.
+ */
+__attribute__((target("sse2")))
+static void
+SVG_sincos_sse2_4(const float* x, float* s, float* c) {
+    __m128 xf = _mm_loadu_ps(x);
+ 
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(xf, _mm_set1_ps(SVG_2OPI_F)));
+    __m128 qf = _mm_cvtepi32_ps(q);
+ 
+    __m128 z = _mm_sub_ps(xf, _mm_mul_ps(qf, _mm_set1_ps(SVG_PIO2_1F)));
+    z = _mm_sub_ps(z, _mm_mul_ps(qf, _mm_set1_ps(SVG_PIO2_2F)));
+    z = _mm_sub_ps(z, _mm_mul_ps(qf, _mm_set1_ps(SVG_PIO2_3F)));
+    __m128 zz = _mm_mul_ps(z, z);
+ 
+    __m128 ps = _mm_set1_ps(SVG_SIN_C0F);
+    ps = _mm_add_ps(_mm_mul_ps(ps, zz), _mm_set1_ps(SVG_SIN_C1F));
+    ps = _mm_add_ps(_mm_mul_ps(ps, zz), _mm_set1_ps(SVG_SIN_C2F));
+    __m128 sin_z = _mm_add_ps(z, _mm_mul_ps(_mm_mul_ps(z, zz), ps));
+ 
+    __m128 pc = _mm_set1_ps(SVG_COS_C0F);
+    pc = _mm_add_ps(_mm_mul_ps(pc, zz), _mm_set1_ps(SVG_COS_C1F));
+    pc = _mm_add_ps(_mm_mul_ps(pc, zz), _mm_set1_ps(SVG_COS_C2F));
+    __m128 cos_z = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(_mm_set1_ps(.5f), zz)),
+                              _mm_mul_ps(_mm_mul_ps(zz, zz), pc));
+ 
+    // odd quadrants swap sin and cos; bit 1 of q (resp. q + 1) negates sin (resp. cos)
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)),
+                                                   _mm_set1_epi32(1)));
+    __m128 sin_x = _mm_or_ps(_mm_and_ps(swap, cos_z), _mm_andnot_ps(swap, sin_z));
+    __m128 cos_x = _mm_or_ps(_mm_and_ps(swap, sin_z), _mm_andnot_ps(swap, cos_z));
+    __m128 sin_sgn = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+    __m128 cos_sgn = _mm_castsi128_ps(
+           _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+ 
+    _mm_storeu_ps(s, _mm_xor_ps(sin_x, sin_sgn));
+    _mm_storeu_ps(c, _mm_xor_ps(cos_x, cos_sgn));
+}
+ 
+__attribute__((target("sse2")))
+void
+SVG_sincos_sse2(const float* x, float* s, float* c, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        SVG_sincos_sse2_4(x + i, s + i, c + i);
+    }
+    if (i < n) {
+        float tx[4] = {0.f, 0.f, 0.f, 0.f};
+        float ts[4], tc[4];
+        memcpy(tx, x + i, (n - i) * sizeof(float));
+        SVG_sincos_sse2_4(tx, ts, tc);
+        memcpy(s + i, ts, (n - i) * sizeof(float));
+        memcpy(c + i, tc, (n - i) * sizeof(float));
+    }
+}
+ 
+__attribute__((target("avx2")))
+static void
+SVG_sincos_avx2_8(const float* x, float* s, float* c) {
+    __m256 xf = _mm256_loadu_ps(x);
+ 
+    __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(xf, _mm256_set1_ps(SVG_2OPI_F)));
+    __m256 qf = _mm256_cvtepi32_ps(q);
+ 
+    __m256 z = _mm256_sub_ps(xf, _mm256_mul_ps(qf, _mm256_set1_ps(SVG_PIO2_1F)));
+    z = _mm256_sub_ps(z, _mm256_mul_ps(qf, _mm256_set1_ps(SVG_PIO2_2F)));
+    z = _mm256_sub_ps(z, _mm256_mul_ps(qf, _mm256_set1_ps(SVG_PIO2_3F)));
+    __m256 zz = _mm256_mul_ps(z, z);
+ 
+    __m256 ps = _mm256_set1_ps(SVG_SIN_C0F);
+    ps = _mm256_add_ps(_mm256_mul_ps(ps, zz), _mm256_set1_ps(SVG_SIN_C1F));
+    ps = _mm256_add_ps(_mm256_mul_ps(ps, zz), _mm256_set1_ps(SVG_SIN_C2F));
+    __m256 sin_z = _mm256_add_ps(z, _mm256_mul_ps(_mm256_mul_ps(z, zz), ps));
+ 
+    __m256 pc = _mm256_set1_ps(SVG_COS_C0F);
+    pc = _mm256_add_ps(_mm256_mul_ps(pc, zz), _mm256_set1_ps(SVG_COS_C1F));
+    pc = _mm256_add_ps(_mm256_mul_ps(pc, zz), _mm256_set1_ps(SVG_COS_C2F));
+    __m256 cos_z = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(_mm256_set1_ps(.5f), zz)),
+                                 _mm256_mul_ps(_mm256_mul_ps(zz, zz), pc));
+ 
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)),
+                                                         _mm256_set1_epi32(1)));
+    __m256 sin_x = _mm256_blendv_ps(sin_z, cos_z, swap);
+    __m256 cos_x = _mm256_blendv_ps(cos_z, sin_z, swap);
+    __m256 sin_sgn = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+    __m256 cos_sgn = _mm256_castsi256_ps(
+           _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)),
+                                              _mm256_set1_epi32(2)), 30));
+ 
+    _mm256_storeu_ps(s, _mm256_xor_ps(sin_x, sin_sgn));
+    _mm256_storeu_ps(c, _mm256_xor_ps(cos_x, cos_sgn));
+}
+ 
+__attribute__((target("avx2")))
+void
+SVG_sincos_avx2(const float* x, float* s, float* c, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        SVG_sincos_avx2_8(x + i, s + i, c + i);
+    }
+    if (i < n) {
+        float tx[8] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+        float ts[8], tc[8];
+        memcpy(tx, x + i, (n - i) * sizeof(float));
+        SVG_sincos_avx2_8(tx, ts, tc);
+        memcpy(s + i, ts, (n - i) * sizeof(float));
+        memcpy(c + i, tc, (n - i) * sizeof(float));
+    }
+}
+#endif
+ 
+SVG_proc_sincos
+SVG_sincos_select(void) {
+#if SVG_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &SVG_sincos_avx2;
+    if (__builtin_cpu_supports("sse2")) return &SVG_sincos_sse2;
+#endif
+    return &SVG_sincos_scalar;
+}
+ 
+// chosen once before main runs, read-only afterwards
+static SVG_proc_sincos SVG_sincos_impl = &SVG_sincos_scalar;
+ 
+#if SVG_HAVE_X86_SIMD
+__attribute__((constructor))
+static void
+SVG_sincos_init(void) {
+    SVG_sincos_impl = SVG_sincos_select();
+}
+#endif
+ 
+void
+SVG_sincos(const float* x, float* s, float* c, size_t n) {
+    SVG_sincos_impl(x, s, c, n);
+}
+ 
 #define SVG_COLOR(name, value) \
     struct SVG_string* name = SVG_string_new(sizeof(value) - 1); \
     SVG_string_assign(name, value);
@@ -590,21 +987,49 @@ clock_min_ticks(struct SVG_shape* root,
 }
  
 void
+clock_hand_set(struct SVG_shape* line,
+               float pos, float r,
+               float start_r, float end_r) {
+    SVGSHP_line_set(line,
+                    start_r * cosf(pos + 3 * SVG_PI / 2) + r,
+                    start_r * sinf(pos + 3 * SVG_PI / 2) + r,
+                    end_r * cosf(pos + 3 * SVG_PI / 2) + r,
+                    end_r * sinf(pos + 3 * SVG_PI / 2) + r);
+}
+ 
+struct SVG_shape*
 clock_hand(struct SVG_shape* root,
            float pos, float r,
            float start_r, float end_r,
            struct SVG_string* color) {
-    SVG_shape_add_child(root,
-                        SVGSHP_line_new(start_r * cosf(pos + 3 * SVG_PI / 2) + r,
-                                        start_r * sinf(pos + 3 * SVG_PI / 2) + r,
-                                        end_r * cosf(pos + 3 * SVG_PI / 2) + r,
-                                        end_r * sinf(pos + 3 * SVG_PI / 2) + r,
-                                        color));
+    struct SVG_shape* line = SVG_shape_add_child(root,
+                                                 SVGSHP_line_new(0.f, 0.f, 0.f, 0.f, color));
+    clock_hand_set(line, pos, r, start_r, end_r);
+    return line;
 }
  
-#define SVG_COLOR_PALE "77"
+/*
+ * Handle to the two lines of a hand, owned by the tree they were added to.
+ * Stays valid until the tree is destroyed.
+ */
+struct clock_hand_lines {
+    struct SVG_shape* _line;
+    struct SVG_shape* _pale;
+    float _r;
+    float _start_r;
+    float _end_r;
+};
  
 void
+clock_hand_move(struct clock_hand_lines* hand, float pos) {
+    assert(hand);
+    clock_hand_set(hand->_line, pos, hand->_r, hand->_start_r, hand->_end_r);
+    clock_hand_set(hand->_pale, pos, hand->_r, hand->_start_r, hand->_r);
+}
+ 
+#define SVG_COLOR_PALE "77"
+ 
+struct clock_hand_lines
 clock_hour_hand(struct SVG_shape* root,
                 float pos, float r) {
     SVG_COLOR(clr_hour, "#FF7A93")
@@ -612,14 +1037,20 @@ clock_hour_hand(struct SVG_shape* root,
  
     float start_r = 0.f;
     float end_r = r / 3.f;
-    clock_hand(root, pos, r, start_r, end_r, clr_hour);
-    clock_hand(root, pos, r, start_r, r, clr_hour_pale);
+    struct clock_hand_lines hand = {
+           ._line = clock_hand(root, pos, r, start_r, end_r, clr_hour),
+           ._pale = clock_hand(root, pos, r, start_r, r, clr_hour_pale),
+           ._r = r,
+           ._start_r = start_r,
+           ._end_r = end_r,
+    };
  
     SVG_string_destroy(&clr_hour);
     SVG_string_destroy(&clr_hour_pale);
+    return hand;
 }
  
-void
+struct clock_hand_lines
 clock_min_hand(struct SVG_shape* root,
                float pos, float r) {
     SVG_COLOR(clr_min, "#B9F27C")
@@ -627,14 +1058,20 @@ clock_min_hand(struct SVG_shape* root,
  
     float start_r = r / 3.f;
     float end_r = 2.f * r / 3.f;
-    clock_hand(root, pos, r, start_r, end_r, clr_min);
-    clock_hand(root, pos, r, start_r, r, clr_min_pale);
+    struct clock_hand_lines hand = {
+           ._line = clock_hand(root, pos, r, start_r, end_r, clr_min),
+           ._pale = clock_hand(root, pos, r, start_r, r, clr_min_pale),
+           ._r = r,
+           ._start_r = start_r,
+           ._end_r = end_r,
+    };
  
     SVG_string_destroy(&clr_min);
     SVG_string_destroy(&clr_min_pale);
+    return hand;
 }
  
-void
+struct clock_hand_lines
 clock_sec_hand(struct SVG_shape* root,
                float pos, float r) {
     SVG_COLOR(clr_sec, "#AD8EE6")
@@ -642,15 +1079,266 @@ clock_sec_hand(struct SVG_shape* root,
  
     float start_r = 2.f * r / 3.f;
     float end_r = r;
-    clock_hand(root, pos, r, start_r, end_r, clr_sec);
-    clock_hand(root, pos, r, start_r, r, clr_sec_pale);
+    struct clock_hand_lines hand = {
+           ._line = clock_hand(root, pos, r, start_r, end_r, clr_sec),
+           ._pale = clock_hand(root, pos, r, start_r, r, clr_sec_pale),
+           ._r = r,
+           ._start_r = start_r,
+           ._end_r = end_r,
+    };
  
     SVG_string_destroy(&clr_sec);
     SVG_string_destroy(&clr_sec_pale);
+    return hand;
+}
+ 
+void
+clock_hand_positions(float real_h, float real_m, float real_s,
+                     float* hour_pos, float* min_pos, float* sec_pos) {
+    assert(hour_pos);
+    assert(min_pos);
+    assert(sec_pos);
+ 
+    float effective_h = real_h + real_m / 60.f + real_s / 60.f / 60.f;
+    float effective_m = real_m + real_s / 60.f;
+    float effective_s = real_s;
+ 
+    *hour_pos = effective_h / 24.f * SVG_PI * 2;
+    *min_pos = effective_m / 60.f * SVG_PI * 2;
+    *sec_pos = effective_s / 60.f * SVG_PI * 2;
+}
+ 
+///////////////////////////////////// BATCH ////////////////////////////////////
+/*
+ * Batch geometry of the hands for many timestamps at once, in
+ * structure-of-arrays form. The sines and cosines come from SVG_sincos and
+ * the endpoints are formed with the same float operations as clock_hand.
+ * Printed at %.4f, every coordinate is within one unit of the last digit of
+ * what the tree prints, which clock_batch_check verifies for a whole day.
+ */
+enum clock_hand_kind {
+    CLOCK_HOUR,
+    CLOCK_HOUR_PALE,
+    CLOCK_MIN,
+    CLOCK_MIN_PALE,
+    CLOCK_SEC,
+    CLOCK_SEC_PALE,
+    CLOCK_HAND_COUNT,
+};
+ 
+struct clock_hand_geometry {
+    size_t _len;
+    float* _x1[CLOCK_HAND_COUNT];
+    float* _y1[CLOCK_HAND_COUNT];
+    float* _x2[CLOCK_HAND_COUNT];
+    float* _y2[CLOCK_HAND_COUNT];
+};
+ 
+struct clock_hand_geometry*
+clock_hand_geometry_new(size_t len) {
+    struct clock_hand_geometry* geom = xmalloc(sizeof(struct clock_hand_geometry));
+    geom->_len = len;
+    for (int k = 0; k < CLOCK_HAND_COUNT; ++k) {
+        geom->_x1[k] = xcalloc(len ? len : 1, sizeof(float));
+        geom->_y1[k] = xcalloc(len ? len : 1, sizeof(float));
+        geom->_x2[k] = xcalloc(len ? len : 1, sizeof(float));
+        geom->_y2[k] = xcalloc(len ? len : 1, sizeof(float));
+    }
+    return geom;
+}
+ 
+void
+clock_hand_geometry_destroy(struct clock_hand_geometry** geom) {
+    assert(geom);
+    assert(*geom);
+    for (int k = 0; k < CLOCK_HAND_COUNT; ++k) {
+        free((*geom)->_x1[k]);
+        free((*geom)->_y1[k]);
+        free((*geom)->_x2[k]);
+        free((*geom)->_y2[k]);
+    }
+    free(*geom);
+    *geom = 0;
+}
+ 
+/*
+ * Fills geom with all six hand lines for each of the n timestamps, given in
+ * seconds since midnight, i.e. in [0, 24 * 60 * 60). geom must have been
+ * created with at least n length.
+ */
+#define CLOCK_BATCH_BLOCK 256
+ 
+void
+clock_hands_batch(const long* secs, size_t n, float r,
+                  struct clock_hand_geometry* geom) {
+    assert(secs || !n);
+    assert(geom);
+    assert(geom->_len >= n);
+ 
+    // same radii as clock_{hour,min,sec}_hand
+    const float start_rs[3] = {0.f, r / 3.f, 2.f * r / 3.f};
+    const float end_rs[3] = {r / 3.f, 2.f * r / 3.f, r};
+ 
+    for (size_t base = 0; base < n; base += CLOCK_BATCH_BLOCK) {
+        size_t len = n - base < CLOCK_BATCH_BLOCK ? n - base : CLOCK_BATCH_BLOCK;
+        float angle[3][CLOCK_BATCH_BLOCK];
+        float sin_a[CLOCK_BATCH_BLOCK];
+        float cos_a[CLOCK_BATCH_BLOCK];
+ 
+        for (size_t i = 0; i < len; ++i) {
+            long sec = secs[base + i];
+            assert(sec >= 0 && sec < 24 * 60 * 60);
+            float pos[3];
+            clock_hand_positions((float) (sec / 3600),
+                                 (float) (sec / 60 % 60),
+                                 (float) (sec % 60),
+                                 &pos[0], &pos[1], &pos[2]);
+            for (int h = 0; h < 3; ++h) angle[h][i] = pos[h] + 3 * SVG_PI / 2;
+        }
+ 
+        for (int h = 0; h < 3; ++h) {
+            SVG_sincos(angle[h], sin_a, cos_a, len);
+ 
+            float start_r = start_rs[h];
+            float end_r = end_rs[h];
+            float* x1 = geom->_x1[2 * h] + base;
+            float* y1 = geom->_y1[2 * h] + base;
+            float* x2 = geom->_x2[2 * h] + base;
+            float* y2 = geom->_y2[2 * h] + base;
+            float* x1_pale = geom->_x1[2 * h + 1] + base;
+            float* y1_pale = geom->_y1[2 * h + 1] + base;
+            float* x2_pale = geom->_x2[2 * h + 1] + base;
+            float* y2_pale = geom->_y2[2 * h + 1] + base;
+            for (size_t i = 0; i < len; ++i) {
+                x1[i] = x1_pale[i] = start_r * cos_a[i] + r;
+                y1[i] = y1_pale[i] = start_r * sin_a[i] + r;
+                x2[i] = end_r * cos_a[i] + r;
+                y2[i] = end_r * sin_a[i] + r;
+                x2_pale[i] = r * cos_a[i] + r;
+                y2_pale[i] = r * sin_a[i] + r;
+            }
+        }
+    }
+}
+ 
+double
+clock_sincos_time(SVG_proc_sincos impl, const float* x, float* s, float* c, size_t n) {
+    double best = 0.;
+    for (int run = 0; run < 5; ++run) {
+        clock_t start = clock();
+        impl(x, s, c, n);
+        double ms = (double) (clock() - start) * 1000. / CLOCKS_PER_SEC;
+        if (run == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+ 
+double
+clock_batch_time(const long* secs, size_t n, float r,
+                 struct clock_hand_geometry* geom) {
+    double best = 0.;
+    for (int run = 0; run < 5; ++run) {
+        clock_t start = clock();
+        clock_hands_batch(secs, n, r, geom);
+        double ms = (double) (clock() - start) * 1000. / CLOCKS_PER_SEC;
+        if (run == 0 || ms < best) best = ms;
+    }
+    return best;
 }
  
+/*
+ * Self-check of the batch path over every second of a day: compares each
+ * coordinate against the tree built by clock_{hour,min,sec}_hand as printed
+ * at %.4f, and times the SVG_sincos kernels and the whole batch against scalar
+ * libm.
+ * Fails if a coordinate is off by more than one unit of the last digit or the
+ * selected kernel is slower than libm.
+ */
 int
-main(void) {
+clock_batch_check(float r) {
+    const size_t n = 24 * 60 * 60;
+    long* secs = xmalloc(n * sizeof(long));
+    for (size_t i = 0; i < n; ++i) secs[i] = (long) i;
+ 
+    struct clock_hand_geometry* geom = clock_hand_geometry_new(n);
+    clock_hands_batch(secs, n, r, geom);
+ 
+    struct SVG_shape* root = SVGSHP_root_new((int) (2 * r), (int) (2 * r));
+    struct clock_hand_lines hands[3] = {
+           clock_hour_hand(root, 0.f, r),
+           clock_min_hand(root, 0.f, r),
+           clock_sec_hand(root, 0.f, r),
+    };
+    static const char* const coords[4] = {"x1", "y1", "x2", "y2"};
+    float* angles = xmalloc(3 * n * sizeof(float));
+    size_t differing = 0;
+    long max_units = 0;
+    for (size_t i = 0; i < n; ++i) {
+        float pos[3];
+        clock_hand_positions((float) (secs[i] / 3600),
+                             (float) (secs[i] / 60 % 60),
+                             (float) (secs[i] % 60),
+                             &pos[0], &pos[1], &pos[2]);
+        for (int h = 0; h < 3; ++h) clock_hand_move(&hands[h], pos[h]);
+        for (int h = 0; h < 3; ++h) angles[h * n + i] = pos[h] + 3 * SVG_PI / 2;
+ 
+        for (int k = 0; k < CLOCK_HAND_COUNT; ++k) {
+            struct SVG_shape* line = k % 2 ? hands[k / 2]._pale : hands[k / 2]._line;
+            const float batch[4] = {geom->_x1[k][i], geom->_y1[k][i],
+                                    geom->_x2[k][i], geom->_y2[k][i]};
+            for (int j = 0; j < 4; ++j) {
+                float tree = *(float*) SVG_param_list_find(line->_params, coords[j])->_value;
+                char tree_str[32], batch_str[32];
+                snprintf(tree_str, sizeof tree_str, "%.4f", (double) tree);
+                snprintf(batch_str, sizeof batch_str, "%.4f", (double) batch[j]);
+                if (strcmp(tree_str, batch_str) == 0) continue;
+ 
+                ++differing;
+                long units = labs(lround((strtod(tree_str, 0) - strtod(batch_str, 0)) * 1e4));
+                if (units > max_units) max_units = units;
+            }
+        }
+    }
+    MBR_CALL(root, destroy)(root);
+ 
+    float* sin_a = xmalloc(3 * n * sizeof(float));
+    float* cos_a = xmalloc(3 * n * sizeof(float));
+    double selected_kernel_ms = clock_sincos_time(SVG_sincos_impl, angles, sin_a, cos_a, 3 * n);
+    double scalar_kernel_ms = clock_sincos_time(&SVG_sincos_scalar, angles, sin_a, cos_a, 3 * n);
+    printf("sincos over a day: %.2f ms scalar libm", scalar_kernel_ms);
+#if SVG_HAVE_X86_SIMD
+    if (__builtin_cpu_supports("sse2")) {
+        printf(", %.2f ms sse2", clock_sincos_time(&SVG_sincos_sse2, angles, sin_a, cos_a, 3 * n));
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        printf(", %.2f ms avx2", clock_sincos_time(&SVG_sincos_avx2, angles, sin_a, cos_a, 3 * n));
+    }
+#endif
+    printf(", %.2f ms selected\n", selected_kernel_ms);
+    free(angles);
+    free(sin_a);
+    free(cos_a);
+ 
+    double simd_ms = clock_batch_time(secs, n, r, geom);
+    SVG_proc_sincos selected = SVG_sincos_impl;
+    SVG_sincos_impl = &SVG_sincos_scalar;
+    double scalar_ms = clock_batch_time(secs, n, r, geom);
+    SVG_sincos_impl = selected;
+ 
+    printf("coordinates differing at %%.4f: %zu of %zu, at most %ld unit(s)\n",
+           differing, n * CLOCK_HAND_COUNT * 4, max_units);
+    printf("batch over a day: %.2f ms selected kernel, %.2f ms scalar libm\n",
+           simd_ms, scalar_ms);
+ 
+    clock_hand_geometry_destroy(&geom);
+    free(secs);
+    return max_units > 1 || selected_kernel_ms > scalar_kernel_ms || simd_ms > scalar_ms;
+}
+ 
+int
+main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--batch-check") == 0) return clock_batch_check(210.f);
+ 
     SVG_COLOR(clr_fg, "#A9B1D6")
     SVG_COLOR(clr_fg_pale, "#A9B1D6" SVG_COLOR_PALE)
     SVG_COLOR(clr_bg, "#20212E")
@@ -674,13 +1362,12 @@ main(void) {
     float real_h, real_m, real_s;
     if (scanf("%f %f %f", &real_h, &real_m, &real_s) != 3) exit(2);
  
-    float effective_h = real_h + real_m / 60.f + real_s / 60.f / 60.f;
-    float effective_m = real_m + real_s / 60.f;
-    float effective_s = real_s;
+    float hour_pos, min_pos, sec_pos;
+    clock_hand_positions(real_h, real_m, real_s, &hour_pos, &min_pos, &sec_pos);
  
-    clock_hour_hand(root, effective_h / 24.f * SVG_PI * 2, R);
-    clock_min_hand(root, effective_m / 60.f * SVG_PI * 2, R);
-    clock_sec_hand(root, effective_s / 60.f * SVG_PI * 2, R);
+    clock_hour_hand(root, hour_pos, R);
+    clock_min_hand(root, min_pos, R);
+    clock_sec_hand(root, sec_pos, R);
  
     SVG_print(root, clock);
  